@@ -5,8 +5,104 @@
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <bitset>
+#include <climits>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
 using namespace std;
 
+// First line of data and export files whose text fields are escaped.
+// Files without it were written before escaping existed and are read as-is.
+const string DATA_FORMAT_HEADER = "#hospital-data v2";
+
+// Escapes backslashes, commas and line breaks so that free text (names,
+// medical history, ...) cannot split a record or a line in the data files
+string escapeField(const string& field) {
+    if (field.find_first_of("\\,\n\r") == string::npos) return field;
+    
+    string out;
+    out.reserve(field.size() + 8);
+    for (char c : field) {
+        switch (c) {
+            case '\\': out += "\\\\"; break;
+            case ',': out += "\\,"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            default: out += c;
+        }
+    }
+    return out;
+}
+
+// Splits a record into fields on unescaped delimiters and unescapes each
+// field (legacy lines, escaped == false, are split on every delimiter).
+// Unlike getline, keeps empty trailing fields so that the field count of a
+// line can be checked exactly.
+vector<string> splitFields(const string& line, char delim, bool escaped = true) {
+    const char special[] = { escaped ? '\\' : delim, delim, '\0' };
+    vector<string> fields(1);
+    size_t pos = 0;
+    while (pos < line.size()) {
+        // Copy the plain run up to the next backslash or delimiter in one go
+        size_t stop = line.find_first_of(special, pos);
+        if (stop == string::npos) stop = line.size();
+        fields.back().append(line, pos, stop - pos);
+        if (stop == line.size()) break;
+        
+        if (line[stop] == delim) {
+            fields.emplace_back();
+        } else if (stop + 1 < line.size()) {
+            char next = line[++stop];
+            fields.back() += next == 'n' ? '\n' : next == 'r' ? '\r' : next;
+        } else {
+            fields.back() += '\\';
+        }
+        pos = stop + 1;
+    }
+    return fields;
+}
+
+// Rewrites a line from a file without DATA_FORMAT_HEADER so that it splits
+// into the same fields when read as escaped: its backslashes are plain text
+string legacyLineAsEscaped(const string& line) {
+    string out;
+    out.reserve(line.size() + 8);
+    for (char c : line) {
+        if (c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+// Strict integer parse: the whole field must be a number that fits in an int
+bool parseInt(const string& field, int& out) {
+    if (field.empty()) return false;
+    size_t pos = (field[0] == '-' || field[0] == '+') ? 1 : 0;
+    if (pos == field.size()) return false;
+    long long value = 0;
+    for (; pos < field.size(); pos++) {
+        if (field[pos] < '0' || field[pos] > '9') return false;
+        value = value * 10 + (field[pos] - '0');
+        if (value > (long long)INT_MAX + 1) return false;
+    }
+    if (field[0] == '-') value = -value;
+    if (value < INT_MIN || value > INT_MAX) return false;
+    out = (int)value;
+    return true;
+}
+
 // Base class: Person
 class Person {
 protected:
@@ -14,6 +110,20 @@ protected:
     int id;
     int age;
     string contact;
+    
+    // Validates the ID,Name,Age fields shared by all person records.
+    // Without strict, only checks that the numbers are integers.
+    static bool parsePersonFields(const vector<string>& fields, int& id, int& age, string& error, bool strict) {
+        if (!parseInt(fields[0], id) || (strict && id <= 0)) {
+            error = "invalid ID '" + fields[0] + "'";
+            return false;
+        }
+        if (!parseInt(fields[2], age) || (strict && (age < 0 || age > 150))) {
+            error = "invalid age '" + fields[2] + "'";
+            return false;
+        }
+        return true;
+    }
 
 public:
     Person() : id(0), age(0) {}
@@ -82,25 +192,31 @@ public:
     
     // File operations
     string toFileString() const {
-        return to_string(id) + "," + name + "," + to_string(age) + "," + 
-               contact + "," + medicalHistory + "," + currentCondition + "," + 
-               to_string(assignedDoctorId);
+        return to_string(id) + "," + escapeField(name) + "," + to_string(age) + "," + 
+               escapeField(contact) + "," + escapeField(medicalHistory) + "," + 
+               escapeField(currentCondition) + "," + to_string(assignedDoctorId);
     }
     
-    static Patient fromFileString(const string& line) {
-        stringstream ss(line);
-        string token;
-        vector<string> tokens;
-        
-        while (getline(ss, token, ',')) {
-            tokens.push_back(token);
+    // Parses and validates one record; on failure leaves out untouched and sets error.
+    // strict also checks value ranges (used for import); the data files are
+    // read without it so records the old menus accepted still load. escaped
+    // is false for files without DATA_FORMAT_HEADER.
+    static bool tryParse(const string& line, Patient& out, string& error, bool strict = true, bool escaped = true) {
+        vector<string> tokens = splitFields(line, ',', escaped);
+        if (tokens.size() != 7) {
+            error = "expected 7 fields, found " + to_string(tokens.size());
+            return false;
         }
         
-        if (tokens.size() >= 7) {
-            return Patient(tokens[1], stoi(tokens[0]), stoi(tokens[2]), 
-                          tokens[3], tokens[4], tokens[5], stoi(tokens[6]));
+        int id, age, docId;
+        if (!parsePersonFields(tokens, id, age, error, strict)) return false;
+        if (!parseInt(tokens[6], docId) || (strict && docId < 0)) {
+            error = "invalid assigned doctor ID '" + tokens[6] + "'";
+            return false;
         }
-        return Patient();
+        
+        out = Patient(tokens[1], id, age, tokens[3], tokens[4], tokens[5], docId);
+        return true;
     }
 };
 
@@ -162,35 +278,37 @@ public:
             patientsStr += to_string(patientIds[i]);
             if (i < patientIds.size() - 1) patientsStr += ":";
         }
-        return to_string(id) + "," + name + "," + to_string(age) + "," + 
-               contact + "," + specialization + "," + schedule + "," + patientsStr;
+        return to_string(id) + "," + escapeField(name) + "," + to_string(age) + "," + 
+               escapeField(contact) + "," + escapeField(specialization) + "," + 
+               escapeField(schedule) + "," + patientsStr;
     }
     
-    static Doctor fromFileString(const string& line) {
-        stringstream ss(line);
-        string token;
-        vector<string> tokens;
-        
-        while (getline(ss, token, ',')) {
-            tokens.push_back(token);
+    // Parses and validates one record; the patient ID list may be omitted
+    static bool tryParse(const string& line, Doctor& out, string& error, bool strict = true, bool escaped = true) {
+        vector<string> tokens = splitFields(line, ',', escaped);
+        if (tokens.size() != 6 && tokens.size() != 7) {
+            error = "expected 7 fields, found " + to_string(tokens.size());
+            return false;
         }
         
-        if (tokens.size() >= 6) {
-            Doctor doc(tokens[1], stoi(tokens[0]), stoi(tokens[2]), 
-                      tokens[3], tokens[4], tokens[5]);
-            
-            if (tokens.size() == 7 && !tokens[6].empty()) {
-                stringstream pss(tokens[6]);
-                string pid;
-                while (getline(pss, pid, ':')) {
-                    if (!pid.empty()) {
-                        doc.addPatient(stoi(pid));
-                    }
+        int id, age;
+        if (!parsePersonFields(tokens, id, age, error, strict)) return false;
+        
+        Doctor doc(tokens[1], id, age, tokens[3], tokens[4], tokens[5]);
+        if (tokens.size() == 7 && !tokens[6].empty()) {
+            for (const string& pid : splitFields(tokens[6], ':')) {
+                int patientId;
+                if (!strict && pid.empty()) continue;
+                if (!parseInt(pid, patientId) || (strict && patientId <= 0)) {
+                    error = "invalid patient ID '" + pid + "'";
+                    return false;
                 }
+                doc.addPatient(patientId);
             }
-            return doc;
         }
-        return Doctor();
+        
+        out = doc;
+        return true;
     }
 };
 
@@ -238,27 +356,76 @@ public:
     
     // File operations
     string toFileString() const {
-        return to_string(id) + "," + name + "," + to_string(age) + "," + 
-               contact + "," + department + "," + shift + "," + assignedWard;
+        return to_string(id) + "," + escapeField(name) + "," + to_string(age) + "," + 
+               escapeField(contact) + "," + escapeField(department) + "," + 
+               escapeField(shift) + "," + escapeField(assignedWard);
     }
     
-    static Nurse fromFileString(const string& line) {
-        stringstream ss(line);
-        string token;
-        vector<string> tokens;
-        
-        while (getline(ss, token, ',')) {
-            tokens.push_back(token);
+    // Parses and validates one record; on failure leaves out untouched and sets error
+    static bool tryParse(const string& line, Nurse& out, string& error, bool strict = true, bool escaped = true) {
+        vector<string> tokens = splitFields(line, ',', escaped);
+        if (tokens.size() != 7) {
+            error = "expected 7 fields, found " + to_string(tokens.size());
+            return false;
         }
         
-        if (tokens.size() >= 7) {
-            return Nurse(tokens[1], stoi(tokens[0]), stoi(tokens[2]), 
-                        tokens[3], tokens[4], tokens[5], tokens[6]);
-        }
-        return Nurse();
+        int id, age;
+        if (!parsePersonFields(tokens, id, age, error, strict)) return false;
+        
+        out = Nurse(tokens[1], id, age, tokens[3], tokens[4], tokens[5], tokens[6]);
+        return true;
     }
 };
 
+// Appointment status as a compact numeric code
+enum AppointmentStatus : uint8_t {
+    STATUS_SCHEDULED = 0,
+    STATUS_COMPLETED = 1,
+    STATUS_CANCELLED = 2,
+    STATUS_UNKNOWN = 3
+};
+
+AppointmentStatus statusCode(const string& status) {
+    if (status == "Scheduled") return STATUS_SCHEDULED;
+    if (status == "Completed") return STATUS_COMPLETED;
+    if (status == "Cancelled") return STATUS_CANCELLED;
+    return STATUS_UNKNOWN;
+}
+
+// Reads 1 to maxDigits decimal digits starting at pos; false if there are none
+bool readDigits(const string& text, size_t& pos, size_t maxDigits, int& out) {
+    size_t start = pos;
+    out = 0;
+    while (pos < text.size() && pos - start < maxDigits && text[pos] >= '0' && text[pos] <= '9') {
+        out = out * 10 + (text[pos++] - '0');
+    }
+    return pos > start;
+}
+
+// Consumes the expected separator at pos
+bool readSeparator(const string& text, size_t& pos, char separator) {
+    if (pos >= text.size() || text[pos] != separator) return false;
+    pos++;
+    return true;
+}
+
+// Converts "DD/MM/YYYY" and "HH:MM" to a sortable YYYYMMDDHHMM number, or -1 if malformed
+int64_t appointmentTimestamp(const string& date, const string& time) {
+    int day, month, year, hour = 0, minute = 0;
+    size_t pos = 0;
+    if (!readDigits(date, pos, 2, day) || !readSeparator(date, pos, '/') ||
+        !readDigits(date, pos, 2, month) || !readSeparator(date, pos, '/') ||
+        !readDigits(date, pos, 4, year) || pos != date.size()) return -1;
+    if (!time.empty()) {
+        pos = 0;
+        if (!readDigits(time, pos, 2, hour) || !readSeparator(time, pos, ':') ||
+            !readDigits(time, pos, 2, minute) || pos != time.size()) return -1;
+    }
+    if (day < 1 || day > 31 || month < 1 || month > 12 || year < 0 || year > 9999 ||
+        hour < 0 || hour > 23 || minute < 0 || minute > 59) return -1;
+    return (((int64_t)year * 100 + month) * 100 + day) * 10000 + hour * 100 + minute;
+}
+
 // Appointment class
 class Appointment {
 private:
@@ -301,41 +468,725 @@ public:
     // File operations
     string toFileString() const {
         return to_string(appointmentId) + "," + to_string(patientId) + "," + 
-               to_string(doctorId) + "," + date + "," + time + "," + status;
+               to_string(doctorId) + "," + escapeField(date) + "," + escapeField(time) + "," + 
+               escapeField(status);
     }
     
-    static Appointment fromFileString(const string& line) {
-        stringstream ss(line);
-        string token;
-        vector<string> tokens;
+    // Parses and validates one record; on failure leaves out untouched and sets error
+    static bool tryParse(const string& line, Appointment& out, string& error, bool strict = true, bool escaped = true) {
+        vector<string> tokens = splitFields(line, ',', escaped);
+        if (tokens.size() != 6) {
+            error = "expected 6 fields, found " + to_string(tokens.size());
+            return false;
+        }
         
-        while (getline(ss, token, ',')) {
-            tokens.push_back(token);
+        int appId, pId, dId;
+        if (!parseInt(tokens[0], appId) || (strict && appId <= 0)) {
+            error = "invalid appointment ID '" + tokens[0] + "'";
+            return false;
+        }
+        if (!parseInt(tokens[1], pId) || (strict && pId <= 0)) {
+            error = "invalid patient ID '" + tokens[1] + "'";
+            return false;
+        }
+        if (!parseInt(tokens[2], dId) || (strict && dId <= 0)) {
+            error = "invalid doctor ID '" + tokens[2] + "'";
+            return false;
+        }
+        if (strict && appointmentTimestamp(tokens[3], tokens[4]) < 0) {
+            error = "invalid date/time '" + tokens[3] + " " + tokens[4] + "'";
+            return false;
+        }
+        if (strict && statusCode(tokens[5]) == STATUS_UNKNOWN) {
+            error = "invalid status '" + tokens[5] + "'";
+            return false;
         }
         
-        if (tokens.size() >= 6) {
-            return Appointment(stoi(tokens[0]), stoi(tokens[1]), stoi(tokens[2]), 
-                             tokens[3], tokens[4], tokens[5]);
+        out = Appointment(appId, pId, dId, tokens[3], tokens[4], tokens[5]);
+        return true;
+    }
+};
+
+// Index of the lowest set bit; bits must be non-zero
+inline int lowestSetBit(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(bits);
+#else
+    int index = 0;
+    while (!(bits & 1)) {
+        bits >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+// Selection bitmap: bit i is set when row i matched a filter
+class SelectionBitmap {
+private:
+    vector<uint64_t> words;
+    size_t rows;
+
+public:
+    SelectionBitmap(size_t n = 0, bool selected = false)
+        : words((n + 63) / 64, selected ? ~0ULL : 0ULL), rows(n) {
+        clearTail();
+    }
+    
+    size_t size() const { return rows; }
+    uint64_t* data() { return words.data(); }
+    const uint64_t* data() const { return words.data(); }
+    
+    bool test(size_t row) const {
+        return (words[row / 64] >> (row % 64)) & 1ULL;
+    }
+    
+    // Bits past the last row must stay zero so count() is exact
+    void clearTail() {
+        if (rows % 64 != 0) {
+            words.back() &= (1ULL << (rows % 64)) - 1;
+        }
+    }
+    
+    void andWith(const SelectionBitmap& other) {
+        for (size_t w = 0; w < words.size(); w++) {
+            words[w] &= other.words[w];
         }
-        return Appointment();
+    }
+    
+    void orWith(const SelectionBitmap& other) {
+        for (size_t w = 0; w < words.size(); w++) {
+            words[w] |= other.words[w];
+        }
+    }
+    
+    size_t count() const {
+        size_t total = 0;
+        for (uint64_t w : words) {
+            total += bitset<64>(w).count();
+        }
+        return total;
+    }
+    
+    // Calls fn(row) for every selected row in ascending order
+    template <typename Fn>
+    void forEachSelected(Fn fn) const {
+        for (size_t w = 0; w < words.size(); w++) {
+            uint64_t bits = words[w];
+            while (bits) {
+                fn(w * 64 + lowestSetBit(bits));
+                bits &= bits - 1;
+            }
+        }
+    }
+    
+    // Indices of selected rows in ascending order
+    vector<size_t> selectedRows() const {
+        vector<size_t> result;
+        result.reserve(count());
+        forEachSelected([&result](size_t row) { result.push_back(row); });
+        return result;
+    }
+};
+
+// Filter kernel: selects rows with lo <= column[i] <= hi.
+// Each 64-row block is compared without branches and packed into one word,
+// which lets the compiler vectorize the inner loop.
+template <typename T>
+SelectionBitmap filterRange(const vector<T>& column, T lo, T hi) {
+    SelectionBitmap result(column.size());
+    const T* values = column.data();
+    uint64_t* words = result.data();
+    size_t fullWords = column.size() / 64;
+    
+    for (size_t w = 0; w < fullWords; w++) {
+        const T* block = values + w * 64;
+        uint64_t bits = 0;
+        for (int j = 0; j < 64; j++) {
+            bits |= (uint64_t)((block[j] >= lo) & (block[j] <= hi)) << j;
+        }
+        words[w] = bits;
+    }
+    
+    size_t done = fullWords * 64;
+    if (done < column.size()) {
+        uint64_t bits = 0;
+        for (size_t j = 0; done + j < column.size(); j++) {
+            bits |= (uint64_t)((values[done + j] >= lo) & (values[done + j] <= hi)) << j;
+        }
+        words[fullWords] = bits;
+    }
+    return result;
+}
+
+template <typename T>
+SelectionBitmap filterEquals(const vector<T>& column, T value) {
+    return filterRange(column, value, value);
+}
+
+// Columnar projections of the numeric fields, one entry per row in storage order
+struct PatientColumns {
+    vector<int32_t> id;
+    vector<int32_t> age;
+    vector<int32_t> assignedDoctorId;
+    
+    // Writes one row; row == size appends
+    void store(size_t row, const Patient& p) {
+        if (row == id.size()) {
+            id.push_back(0);
+            age.push_back(0);
+            assignedDoctorId.push_back(0);
+        }
+        id[row] = p.getId();
+        age[row] = p.getAge();
+        assignedDoctorId[row] = p.getAssignedDoctorId();
+    }
+};
+
+struct AppointmentColumns {
+    vector<int32_t> id;
+    vector<int32_t> patientId;
+    vector<int32_t> doctorId;
+    vector<int64_t> timestamp;
+    vector<uint8_t> status;
+    
+    // Writes one row; row == size appends
+    void store(size_t row, const Appointment& app) {
+        if (row == id.size()) {
+            id.push_back(0);
+            patientId.push_back(0);
+            doctorId.push_back(0);
+            timestamp.push_back(0);
+            status.push_back(0);
+        }
+        id[row] = app.getAppointmentId();
+        patientId[row] = app.getPatientId();
+        doctorId[row] = app.getDoctorId();
+        timestamp[row] = appointmentTimestamp(app.getDate(), app.getTime());
+        status[row] = statusCode(app.getStatus());
     }
 };
 
+// Query criteria; unset fields match every row
+struct PatientQuery {
+    int minAge = INT_MIN;
+    int maxAge = INT_MAX;
+    int minId = INT_MIN;
+    int maxId = INT_MAX;
+    optional<int> assignedDoctorId;  // 0 selects patients without a doctor
+};
+
+struct AppointmentQuery {
+    optional<AppointmentStatus> status;
+    optional<int> patientId;
+    optional<int> doctorId;
+    int64_t from = INT64_MIN;  // YYYYMMDDHHMM, see appointmentTimestamp()
+    int64_t to = INT64_MAX;
+};
+
+// Console input for filter queries, shared by the site and network menus.
+// Returns false (after telling the user) if the input is invalid.
+bool readPatientQuery(PatientQuery& q) {
+    int doctorId;
+    
+    cout << "\n=== Filter Patients ===\n";
+    cout << "Enter Minimum Age: ";
+    cin >> q.minAge;
+    cout << "Enter Maximum Age: ";
+    cin >> q.maxAge;
+    if (q.minAge > q.maxAge) {
+        cout << "\nMinimum age cannot be above maximum age!\n";
+        return false;
+    }
+    cout << "Enter Assigned Doctor ID (0 = none, -1 = any): ";
+    cin >> doctorId;
+    if (doctorId >= 0) q.assignedDoctorId = doctorId;
+    return true;
+}
+
+bool readAppointmentQuery(AppointmentQuery& q) {
+    string status, fromDate, toDate;
+    int doctorId;
+    
+    cout << "\n=== Filter Appointments ===\n";
+    cout << "Enter Status (Scheduled/Completed/Cancelled/Any): ";
+    cin >> status;
+    if (status != "Any") {
+        q.status = statusCode(status);
+        if (*q.status == STATUS_UNKNOWN) {
+            cout << "\nInvalid status!\n";
+            return false;
+        }
+    }
+    cout << "Enter Doctor ID (-1 = any): ";
+    cin >> doctorId;
+    if (doctorId >= 0) q.doctorId = doctorId;
+    cout << "Enter From Date (DD/MM/YYYY, - = any): ";
+    cin >> fromDate;
+    cout << "Enter To Date (DD/MM/YYYY, - = any): ";
+    cin >> toDate;
+    
+    if (fromDate != "-") {
+        q.from = appointmentTimestamp(fromDate, "00:00");
+    }
+    if (toDate != "-") {
+        q.to = appointmentTimestamp(toDate, "23:59");
+    }
+    if (q.from == -1 || q.to == -1) {
+        cout << "\nInvalid date!\n";
+        return false;
+    }
+    return true;
+}
+
+void printMatchingPatients(const vector<Patient>& result) {
+    cout << "\n=== Matching Patients (" << result.size() << ") ===\n";
+    for (const auto& p : result) {
+        cout << p.getInfo() << endl;
+    }
+}
+
+void printMatchingAppointments(const vector<Appointment>& result) {
+    if (result.empty()) {
+        cout << "\nNo matching appointments.\n";
+        return;
+    }
+    for (const auto& app : result) {
+        app.displayDetails();
+    }
+}
+
+// Field-by-field equality through the getters, independent of the file format
+bool samePersonFields(const Person& a, const Person& b) {
+    return a.getId() == b.getId() && a.getName() == b.getName() &&
+           a.getAge() == b.getAge() && a.getContact() == b.getContact();
+}
+
+bool sameFields(const Patient& a, const Patient& b) {
+    return samePersonFields(a, b) && a.getMedicalHistory() == b.getMedicalHistory() &&
+           a.getCurrentCondition() == b.getCurrentCondition() &&
+           a.getAssignedDoctorId() == b.getAssignedDoctorId();
+}
+
+bool sameFields(const Doctor& a, const Doctor& b) {
+    return samePersonFields(a, b) && a.getSpecialization() == b.getSpecialization() &&
+           a.getSchedule() == b.getSchedule() && a.getPatientIds() == b.getPatientIds();
+}
+
+bool sameFields(const Nurse& a, const Nurse& b) {
+    return samePersonFields(a, b) && a.getDepartment() == b.getDepartment() &&
+           a.getShift() == b.getShift() && a.getAssignedWard() == b.getAssignedWard();
+}
+
+bool sameFields(const Appointment& a, const Appointment& b) {
+    return a.getAppointmentId() == b.getAppointmentId() && a.getPatientId() == b.getPatientId() &&
+           a.getDoctorId() == b.getDoctorId() && a.getDate() == b.getDate() &&
+           a.getTime() == b.getTime() && a.getStatus() == b.getStatus();
+}
+
+// ID of any stored record
+int recordId(const Person& p) { return p.getId(); }
+int recordId(const Appointment& app) { return app.getAppointmentId(); }
+
 // Hospital Management System class
+// Each instance is one shard: it owns the data files in its own directory and
+// hands out IDs from its own range, so several sites can run side by side.
 class HospitalSystem {
+public:
+    // Size of the ID range owned by each shard. Shard N issues IDs in
+    // [N * SHARD_ID_SPAN + 1, (N + 1) * SHARD_ID_SPAN].
+    static const int SHARD_ID_SPAN = 1000000;
+    
+    // Highest shard index whose whole ID range (plus one past it, for the
+    // next-ID counters) still fits in an int
+    static const int MAX_SHARD = INT_MAX / SHARD_ID_SPAN - 1;
+    
+    static int shardForId(int id) {
+        return id > 0 ? (id - 1) / SHARD_ID_SPAN : -1;
+    }
+
 private:
+    template <typename T>
+    static bool sameRecords(const vector<T>& a, const vector<T>& b, const string& what, string& difference) {
+        if (a.size() != b.size()) {
+            difference = what + " count " + to_string(a.size()) + " vs " + to_string(b.size());
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++) {
+            if (!sameFields(a[i], b[i])) {
+                difference = what + " row " + to_string(i) + " differs (ID " + to_string(recordId(a[i])) + ")";
+                return false;
+            }
+        }
+        return true;
+    }
+
     vector<Patient> patients;
     vector<Doctor> doctors;
     vector<Nurse> nurses;
     vector<Appointment> appointments;
     
+    string dataDir;
+    int shardIndex;
+    
     int nextPatientId;
     int nextDoctorId;
     int nextNurseId;
     int nextAppointmentId;
+    
+    // Numeric columns for filter queries, row i mirroring patients[i] /
+    // appointments[i]. Every change updates its own row, so queries never
+    // rebuild them.
+    PatientColumns patientColumns;
+    AppointmentColumns appointmentColumns;
+    
+    string dataPath(const string& fileName) const {
+        return (filesystem::path(dataDir) / fileName).string();
+    }
+    
+    // Row of each record by ID, kept in step with the vectors above
+    unordered_map<int, size_t> patientRows;
+    unordered_map<int, size_t> doctorRows;
+    unordered_map<int, size_t> nurseRows;
+    unordered_map<int, size_t> appointmentRows;
+    
+    // Unreadable lines from the data files, by file name, written back on save.
+    // Lines from legacy files are stored in escaped form, since saves add the header.
+    unordered_map<string, vector<string>> keptLines;
+    
+    template <typename T>
+    static T* findRow(vector<T>& records, const unordered_map<int, size_t>& rows, int id) {
+        auto it = rows.find(id);
+        return it == rows.end() ? nullptr : &records[it->second];
+    }
+    
+    template <typename T>
+    static const T* findRow(const vector<T>& records, const unordered_map<int, size_t>& rows, int id) {
+        auto it = rows.find(id);
+        return it == rows.end() ? nullptr : &records[it->second];
+    }
+    
+    // Replaces the record with the same ID, or appends it. Returns true if appended.
+    template <typename T>
+    static bool upsertRow(vector<T>& records, unordered_map<int, size_t>& rows, const T& record, int id) {
+        auto it = rows.find(id);
+        if (it != rows.end()) {
+            records[it->second] = record;
+            return false;
+        }
+        rows[id] = records.size();
+        records.push_back(record);
+        return true;
+    }
+    
+    // Keeps a next-ID counter ahead of any ID stored from outside
+    void advanceCounter(int& nextId, int storedId) {
+        if (ownsId(storedId) && storedId >= nextId) {
+            nextId = storedId + 1;
+        }
+    }
+    
+    // Inserts or replaces a record by ID; patients and appointments also
+    // update their column row. Returns true if the record was new.
+    bool storeRecord(const Patient& p) {
+        bool inserted = upsertRow(patients, patientRows, p, p.getId());
+        size_t row = patientRows[p.getId()];
+        patientColumns.store(row, patients[row]);
+        return inserted;
+    }
+    
+    bool storeRecord(const Doctor& d) {
+        return upsertRow(doctors, doctorRows, d, d.getId());
+    }
+    
+    bool storeRecord(const Nurse& n) {
+        return upsertRow(nurses, nurseRows, n, n.getId());
+    }
+    
+    bool storeRecord(const Appointment& app) {
+        bool inserted = upsertRow(appointments, appointmentRows, app, app.getAppointmentId());
+        size_t row = appointmentRows[app.getAppointmentId()];
+        appointmentColumns.store(row, appointments[row]);
+        return inserted;
+    }
+    
+    // Reads one data file and moves its next-ID counter past every loaded ID.
+    // Lines that cannot be read, or that repeat an ID, are reported and kept
+    // as they are so the next save writes them back instead of losing them.
+    template <typename T>
+    void loadRecords(const string& fileName, const unordered_map<int, size_t>& rows, int& nextId) {
+        ifstream file(dataPath(fileName));
+        if (!file.is_open()) return;
+        
+        string line, error;
+        size_t lineNumber = 0;
+        bool escaped = false;
+        while (getline(file, line)) {
+            lineNumber++;
+            if (lineNumber == 1 && line == DATA_FORMAT_HEADER) {
+                escaped = true;
+                continue;
+            }
+            if (line.empty()) continue;
+            
+            T record;
+            if (!T::tryParse(line, record, error, false, escaped)) {
+                // error already describes the problem
+            } else if (rows.count(recordId(record))) {
+                error = "duplicate ID " + to_string(recordId(record));
+            } else {
+                storeRecord(record);
+                advanceCounter(nextId, recordId(record));
+                continue;
+            }
+            cerr << "\nWarning: " << fileName << " line " << lineNumber << ": " << error << " (kept unchanged)\n";
+            keptLines[fileName].push_back(escaped ? line : legacyLineAsEscaped(line));
+        }
+    }
+    
+    void writeKeptLines(ofstream& file, const string& fileName) const {
+        auto it = keptLines.find(fileName);
+        if (it == keptLines.end()) return;
+        for (const string& line : it->second) {
+            file << line << '\n';
+        }
+    }
+    
+    Patient* findPatientMutable(int id) {
+        return findRow(patients, patientRows, id);
+    }
+    
+    Doctor* findDoctorMutable(int id) {
+        return findRow(doctors, doctorRows, id);
+    }
+    
+    // Hands out the next ID from a counter, or returns 0 once this shard's
+    // range is used up (the following IDs would route to the next shard)
+    int issueId(int& nextId) {
+        if (nextId > (shardIndex + 1) * SHARD_ID_SPAN) return 0;
+        return nextId++;
+    }
+    
+    // A next-ID counter is valid if it is still at the start of this shard's
+    // range or its last issued ID belongs to this shard
+    bool ownsCounter(int nextId) const {
+        return nextId == shardIndex * SHARD_ID_SPAN + 1 || ownsId(nextId - 1);
+    }
 
 public:
-    HospitalSystem() : nextPatientId(1), nextDoctorId(1), nextNurseId(1), nextAppointmentId(1) {}
+    struct UpsertResult {
+        size_t inserted = 0;
+        size_t updated = 0;
+    };
+    
+    // shard must be in [0, MAX_SHARD]
+    HospitalSystem(string dir = ".", int shard = 0)
+        : dataDir(dir), shardIndex(shard),
+          nextPatientId(shard * SHARD_ID_SPAN + 1), nextDoctorId(shard * SHARD_ID_SPAN + 1),
+          nextNurseId(shard * SHARD_ID_SPAN + 1), nextAppointmentId(shard * SHARD_ID_SPAN + 1) {}
+    
+    // Getters
+    string getDataDir() const { return dataDir; }
+    int getShardIndex() const { return shardIndex; }
+    const vector<Patient>& getPatients() const { return patients; }
+    const vector<Doctor>& getDoctors() const { return doctors; }
+    const vector<Nurse>& getNurses() const { return nurses; }
+    const vector<Appointment>& getAppointments() const { return appointments; }
+    
+    bool ownsId(int id) const {
+        return shardForId(id) == shardIndex;
+    }
+    
+    // True if both hold the same records in the same order and the same ID
+    // counters; otherwise describes the first difference found
+    bool sameState(const HospitalSystem& other, string& difference) const {
+        if (!sameRecords(patients, other.patients, "patient", difference)) return false;
+        if (!sameRecords(doctors, other.doctors, "doctor", difference)) return false;
+        if (!sameRecords(nurses, other.nurses, "nurse", difference)) return false;
+        if (!sameRecords(appointments, other.appointments, "appointment", difference)) return false;
+        if (nextPatientId != other.nextPatientId || nextDoctorId != other.nextDoctorId ||
+            nextNurseId != other.nextNurseId || nextAppointmentId != other.nextAppointmentId) {
+            difference = "next ID counters differ";
+            return false;
+        }
+        return true;
+    }
+    
+    // Lookups by ID (nullptr if not found)
+    const Patient* findPatient(int id) const {
+        return findRow(patients, patientRows, id);
+    }
+    
+    const Doctor* findDoctor(int id) const {
+        return findRow(doctors, doctorRows, id);
+    }
+    
+    const Nurse* findNurse(int id) const {
+        return findRow(nurses, nurseRows, id);
+    }
+    
+    const Appointment* findAppointment(int id) const {
+        return findRow(appointments, appointmentRows, id);
+    }
+    
+    // Registration without console I/O; each returns the new ID, or 0 if
+    // this shard has no IDs left or the next ID is already taken (existing
+    // records are never overwritten)
+    int registerPatient(string name, int age, string contact, string medicalHistory, string condition) {
+        int id = issueId(nextPatientId);
+        if (id == 0 || findPatient(id)) return 0;
+        storeRecord(Patient(name, id, age, contact, medicalHistory, condition));
+        return id;
+    }
+    
+    int registerDoctor(string name, int age, string contact, string specialization, string schedule) {
+        int id = issueId(nextDoctorId);
+        if (id == 0 || findDoctor(id)) return 0;
+        storeRecord(Doctor(name, id, age, contact, specialization, schedule));
+        return id;
+    }
+    
+    int registerNurse(string name, int age, string contact, string department, string shift, string ward) {
+        int id = issueId(nextNurseId);
+        if (id == 0 || findNurse(id)) return 0;
+        storeRecord(Nurse(name, id, age, contact, department, shift, ward));
+        return id;
+    }
+    
+    // Insert-or-replace by ID, used by bulk import. Records are stored as given,
+    // so importing the same data twice leaves the system unchanged.
+    UpsertResult upsert(const vector<Patient>& batch) {
+        UpsertResult result;
+        for (const auto& p : batch) {
+            if (storeRecord(p)) result.inserted++;
+            else result.updated++;
+            advanceCounter(nextPatientId, p.getId());
+        }
+        return result;
+    }
+    
+    UpsertResult upsert(const vector<Doctor>& batch) {
+        UpsertResult result;
+        for (const auto& d : batch) {
+            if (storeRecord(d)) result.inserted++;
+            else result.updated++;
+            advanceCounter(nextDoctorId, d.getId());
+        }
+        return result;
+    }
+    
+    UpsertResult upsert(const vector<Nurse>& batch) {
+        UpsertResult result;
+        for (const auto& n : batch) {
+            if (storeRecord(n)) result.inserted++;
+            else result.updated++;
+            advanceCounter(nextNurseId, n.getId());
+        }
+        return result;
+    }
+    
+    UpsertResult upsert(const vector<Appointment>& batch) {
+        UpsertResult result;
+        for (const auto& app : batch) {
+            if (storeRecord(app)) result.inserted++;
+            else result.updated++;
+            advanceCounter(nextAppointmentId, app.getAppointmentId());
+        }
+        return result;
+    }
+    
+    // Records an appointment with a doctor of this shard. The patient may live
+    // on another shard; if it lives here its assigned doctor is updated too.
+    // Returns the appointment ID, or 0 if the doctor is not on this shard, the
+    // date or time is invalid, or no free appointment ID is left.
+    int scheduleAppointment(int patientId, int doctorId, string date, string time) {
+        Doctor* doctor = findDoctorMutable(doctorId);
+        if (!doctor || appointmentTimestamp(date, time) < 0) return 0;
+        
+        int appId = issueId(nextAppointmentId);
+        if (appId == 0 || findAppointment(appId)) return 0;
+        doctor->addPatient(patientId);
+        storeRecord(Appointment(appId, patientId, doctorId, date, time));
+        assignDoctorToPatient(patientId, doctorId);
+        return appId;
+    }
+    
+    // Books an appointment between a patient and doctor that both live on this
+    // shard. Returns the appointment ID, or 0 if either ID is unknown.
+    int bookAppointment(int patientId, int doctorId, string date, string time) {
+        if (!findPatient(patientId) || !findDoctor(doctorId)) return 0;
+        return scheduleAppointment(patientId, doctorId, date, time);
+    }
+    
+    bool assignDoctorToPatient(int patientId, int doctorId) {
+        Patient* patient = findPatientMutable(patientId);
+        if (!patient) return false;
+        patient->setAssignedDoctorId(doctorId);
+        patientColumns.store(patientRows[patientId], *patient);
+        return true;
+    }
+    
+    bool cancelAppointment(int appId) {
+        Appointment* app = findRow(appointments, appointmentRows, appId);
+        if (!app) return false;
+        app->setStatus("Cancelled");
+        appointmentColumns.store(appointmentRows[appId], *app);
+        return true;
+    }
+    
+    // Filter queries. select* returns a bitmap over getPatients()/getAppointments()
+    // rows; query* copies out the matching records.
+    SelectionBitmap selectPatients(const PatientQuery& q) const {
+        const PatientColumns& cols = patientColumns;
+        SelectionBitmap selection(patients.size(), true);
+        
+        if (q.minAge != INT_MIN || q.maxAge != INT_MAX) {
+            selection.andWith(filterRange<int32_t>(cols.age, q.minAge, q.maxAge));
+        }
+        if (q.minId != INT_MIN || q.maxId != INT_MAX) {
+            selection.andWith(filterRange<int32_t>(cols.id, q.minId, q.maxId));
+        }
+        if (q.assignedDoctorId) {
+            selection.andWith(filterEquals<int32_t>(cols.assignedDoctorId, *q.assignedDoctorId));
+        }
+        return selection;
+    }
+    
+    SelectionBitmap selectAppointments(const AppointmentQuery& q) const {
+        const AppointmentColumns& cols = appointmentColumns;
+        SelectionBitmap selection(appointments.size(), true);
+        
+        if (q.status) {
+            selection.andWith(filterEquals<uint8_t>(cols.status, *q.status));
+        }
+        if (q.patientId) {
+            selection.andWith(filterEquals<int32_t>(cols.patientId, *q.patientId));
+        }
+        if (q.doctorId) {
+            selection.andWith(filterEquals<int32_t>(cols.doctorId, *q.doctorId));
+        }
+        if (q.from != INT64_MIN || q.to != INT64_MAX) {
+            // Dates that cannot be read have timestamp -1 and never match a range
+            selection.andWith(filterRange<int64_t>(cols.timestamp, max<int64_t>(q.from, 0), q.to));
+        }
+        return selection;
+    }
+    
+    vector<Patient> queryPatients(const PatientQuery& q) const {
+        vector<Patient> result;
+        for (size_t row : selectPatients(q).selectedRows()) {
+            result.push_back(patients[row]);
+        }
+        return result;
+    }
+    
+    vector<Appointment> queryAppointments(const AppointmentQuery& q) const {
+        vector<Appointment> result;
+        for (size_t row : selectAppointments(q).selectedRows()) {
+            result.push_back(appointments[row]);
+        }
+        return result;
+    }
     
     // Patient Management
     void addPatient() {
@@ -356,10 +1207,19 @@ public:
         cout << "Enter Current Condition: ";
         getline(cin, condition);
         
-        Patient p(name, nextPatientId++, age, contact, medicalHistory, condition);
-        patients.push_back(p);
+        if (age < 0 || age > 150) {
+            cout << "\nInvalid age!\n";
+            return;
+        }
+        
+        int id = registerPatient(name, age, contact, medicalHistory, condition);
+        
+        if (id == 0) {
+            cout << "\nCould not assign a new patient ID at this site!\n";
+            return;
+        }
         
-        cout << "\n✓ Patient added successfully! Patient ID: " << p.getId() << endl;
+        cout << "\n✓ Patient added successfully! Patient ID: " << id << endl;
     }
     
     void viewAllPatients() const {
@@ -379,11 +1239,10 @@ public:
         cout << "\nEnter Patient ID to search: ";
         cin >> id;
         
-        for (const auto& p : patients) {
-            if (p.getId() == id) {
-                p.displayDetails();
-                return;
-            }
+        const Patient* p = findPatient(id);
+        if (p) {
+            p->displayDetails();
+            return;
         }
         cout << "\nPatient not found!\n";
     }
@@ -407,10 +1266,19 @@ public:
         cout << "Enter Schedule (e.g., 9AM-5PM): ";
         getline(cin, schedule);
         
-        Doctor d(name, nextDoctorId++, age, contact, specialization, schedule);
-        doctors.push_back(d);
+        if (age < 0 || age > 150) {
+            cout << "\nInvalid age!\n";
+            return;
+        }
+        
+        int id = registerDoctor(name, age, contact, specialization, schedule);
+        
+        if (id == 0) {
+            cout << "\nCould not assign a new doctor ID at this site!\n";
+            return;
+        }
         
-        cout << "\n✓ Doctor added successfully! Doctor ID: " << d.getId() << endl;
+        cout << "\n✓ Doctor added successfully! Doctor ID: " << id << endl;
     }
     
     void viewAllDoctors() const {
@@ -430,11 +1298,10 @@ public:
         cout << "\nEnter Doctor ID to search: ";
         cin >> id;
         
-        for (const auto& d : doctors) {
-            if (d.getId() == id) {
-                d.displayDetails();
-                return;
-            }
+        const Doctor* d = findDoctor(id);
+        if (d) {
+            d->displayDetails();
+            return;
         }
         cout << "\nDoctor not found!\n";
     }
@@ -460,10 +1327,19 @@ public:
         cout << "Enter Assigned Ward: ";
         getline(cin, ward);
         
-        Nurse n(name, nextNurseId++, age, contact, department, shift, ward);
-        nurses.push_back(n);
+        if (age < 0 || age > 150) {
+            cout << "\nInvalid age!\n";
+            return;
+        }
+        
+        int id = registerNurse(name, age, contact, department, shift, ward);
+        
+        if (id == 0) {
+            cout << "\nCould not assign a new nurse ID at this site!\n";
+            return;
+        }
         
-        cout << "\n✓ Nurse added successfully! Nurse ID: " << n.getId() << endl;
+        cout << "\n✓ Nurse added successfully! Nurse ID: " << id << endl;
     }
     
     void viewAllNurses() const {
@@ -493,24 +1369,7 @@ public:
         cin >> doctorId;
         
         // Verify patient and doctor exist
-        bool patientExists = false, doctorExists = false;
-        
-        for (const auto& p : patients) {
-            if (p.getId() == patientId) {
-                patientExists = true;
-                break;
-            }
-        }
-        
-        for (auto& d : doctors) {
-            if (d.getId() == doctorId) {
-                doctorExists = true;
-                d.addPatient(patientId);
-                break;
-            }
-        }
-        
-        if (!patientExists || !doctorExists) {
+        if (!findPatient(patientId) || !findDoctor(doctorId)) {
             cout << "\nInvalid Patient ID or Doctor ID!\n";
             return;
         }
@@ -520,18 +1379,18 @@ public:
         cout << "Enter Time (HH:MM): ";
         cin >> time;
         
-        Appointment app(nextAppointmentId++, patientId, doctorId, date, time);
-        appointments.push_back(app);
+        if (appointmentTimestamp(date, time) < 0) {
+            cout << "\nInvalid date or time!\n";
+            return;
+        }
         
-        // Update patient's assigned doctor
-        for (auto& p : patients) {
-            if (p.getId() == patientId) {
-                p.setAssignedDoctorId(doctorId);
-                break;
-            }
+        int appId = bookAppointment(patientId, doctorId, date, time);
+        if (appId == 0) {
+            cout << "\nCould not assign a new appointment ID at this site!\n";
+            return;
         }
         
-        cout << "\n✓ Appointment booked successfully! Appointment ID: " << app.getAppointmentId() << endl;
+        cout << "\n✓ Appointment booked successfully! Appointment ID: " << appId << endl;
     }
     
     void viewAllAppointments() const {
@@ -551,122 +1410,484 @@ public:
         cout << "\nEnter Appointment ID to cancel: ";
         cin >> appId;
         
-        for (auto& app : appointments) {
-            if (app.getAppointmentId() == appId) {
-                app.setStatus("Cancelled");
-                cout << "\n✓ Appointment cancelled successfully!\n";
-                return;
-            }
+        if (cancelAppointment(appId)) {
+            cout << "\n✓ Appointment cancelled successfully!\n";
+            return;
         }
         cout << "\nAppointment not found!\n";
     }
     
+    // Filter Queries
+    void filterPatients() const {
+        PatientQuery q;
+        if (readPatientQuery(q)) {
+            printMatchingPatients(queryPatients(q));
+        }
+    }
+    
+    void filterAppointments() const {
+        AppointmentQuery q;
+        if (readAppointmentQuery(q)) {
+            printMatchingAppointments(queryAppointments(q));
+        }
+    }
+    
     // File Handling
-    void saveToFiles() {
+    void saveToFiles(bool announce = true) {
+        filesystem::create_directories(dataDir);
+        
         // Save patients
-        ofstream pFile("patients.txt");
+        ofstream pFile(dataPath("patients.txt"));
+        pFile << DATA_FORMAT_HEADER << '\n';
         for (const auto& p : patients) {
-            pFile << p.toFileString() << endl;
+            pFile << p.toFileString() << '\n';
         }
+        writeKeptLines(pFile, "patients.txt");
         pFile.close();
         
         // Save doctors
-        ofstream dFile("doctors.txt");
+        ofstream dFile(dataPath("doctors.txt"));
+        dFile << DATA_FORMAT_HEADER << '\n';
         for (const auto& d : doctors) {
-            dFile << d.toFileString() << endl;
+            dFile << d.toFileString() << '\n';
         }
+        writeKeptLines(dFile, "doctors.txt");
         dFile.close();
         
         // Save nurses
-        ofstream nFile("nurses.txt");
+        ofstream nFile(dataPath("nurses.txt"));
+        nFile << DATA_FORMAT_HEADER << '\n';
         for (const auto& n : nurses) {
-            nFile << n.toFileString() << endl;
+            nFile << n.toFileString() << '\n';
         }
+        writeKeptLines(nFile, "nurses.txt");
         nFile.close();
         
         // Save appointments
-        ofstream aFile("appointments.txt");
+        ofstream aFile(dataPath("appointments.txt"));
+        aFile << DATA_FORMAT_HEADER << '\n';
         for (const auto& app : appointments) {
-            aFile << app.toFileString() << endl;
+            aFile << app.toFileString() << '\n';
         }
+        writeKeptLines(aFile, "appointments.txt");
         aFile.close();
         
         // Save next IDs
-        ofstream idFile("nextids.txt");
+        ofstream idFile(dataPath("nextids.txt"));
         idFile << nextPatientId << endl;
         idFile << nextDoctorId << endl;
         idFile << nextNurseId << endl;
         idFile << nextAppointmentId << endl;
         idFile.close();
         
-        cout << "\n✓ All data saved successfully!\n";
+        if (announce) {
+            cout << "\n✓ All data saved successfully!\n";
+        }
     }
     
-    void loadFromFiles() {
-        // Load patients
-        ifstream pFile("patients.txt");
-        if (pFile.is_open()) {
-            string line;
-            while (getline(pFile, line)) {
-                if (!line.empty()) {
-                    patients.push_back(Patient::fromFileString(line));
-                }
-            }
-            pFile.close();
+    void loadFromFiles(bool announce = true) {
+        keptLines.clear();
+        loadRecords<Patient>("patients.txt", patientRows, nextPatientId);
+        loadRecords<Doctor>("doctors.txt", doctorRows, nextDoctorId);
+        loadRecords<Nurse>("nurses.txt", nurseRows, nextNurseId);
+        loadRecords<Appointment>("appointments.txt", appointmentRows, nextAppointmentId);
+        
+        // Load next IDs; a missing or stale file never moves a counter back
+        // onto an ID that is already in use
+        ifstream idFile(dataPath("nextids.txt"));
+        if (idFile.is_open()) {
+            int savedPatientId = 0, savedDoctorId = 0, savedNurseId = 0, savedAppointmentId = 0;
+            idFile >> savedPatientId >> savedDoctorId >> savedNurseId >> savedAppointmentId;
+            idFile.close();
+            nextPatientId = max(nextPatientId, savedPatientId);
+            nextDoctorId = max(nextDoctorId, savedDoctorId);
+            nextNurseId = max(nextNurseId, savedNurseId);
+            nextAppointmentId = max(nextAppointmentId, savedAppointmentId);
         }
         
-        // Load doctors
-        ifstream dFile("doctors.txt");
-        if (dFile.is_open()) {
-            string line;
-            while (getline(dFile, line)) {
-                if (!line.empty()) {
-                    doctors.push_back(Doctor::fromFileString(line));
-                }
-            }
-            dFile.close();
+        // Data written under a different shard index would be routed elsewhere
+        if (!ownsCounter(nextPatientId) || !ownsCounter(nextDoctorId) ||
+            !ownsCounter(nextNurseId) || !ownsCounter(nextAppointmentId)) {
+            cerr << "\nWarning: data in '" << dataDir << "' was not created by shard "
+                 << shardIndex << "; ID routing may be wrong.\n";
         }
         
-        // Load nurses
-        ifstream nFile("nurses.txt");
-        if (nFile.is_open()) {
-            string line;
-            while (getline(nFile, line)) {
-                if (!line.empty()) {
-                    nurses.push_back(Nurse::fromFileString(line));
-                }
-            }
-            nFile.close();
+        if (announce) {
+            cout << "\n✓ Data loaded successfully!\n";
+        }
+    }
+};
+
+// Multi-site deployment: one HospitalSystem shard per site directory.
+// ID lookups and bookings are routed to the shard owning the ID range;
+// cross-shard queries run on every shard in parallel and are merged.
+class HospitalNetwork {
+private:
+    vector<HospitalSystem> shards;
+    
+    // Runs fn on every shard concurrently and concatenates the results in shard order
+    template <typename T>
+    vector<T> fanOut(function<vector<T>(const HospitalSystem&)> fn) const {
+        vector<future<vector<T>>> pending;
+        for (const auto& shard : shards) {
+            pending.push_back(async(launch::async, fn, cref(shard)));
         }
         
-        // Load appointments
-        ifstream aFile("appointments.txt");
-        if (aFile.is_open()) {
-            string line;
-            while (getline(aFile, line)) {
-                if (!line.empty()) {
-                    appointments.push_back(Appointment::fromFileString(line));
-                }
+        vector<T> merged;
+        for (auto& f : pending) {
+            vector<T> part = f.get();
+            merged.insert(merged.end(), part.begin(), part.end());
+        }
+        return merged;
+    }
+    
+    // Applies fn to every shard concurrently and waits for all of them
+    void forEachShard(function<void(HospitalSystem&)> fn) {
+        vector<future<void>> pending;
+        for (auto& shard : shards) {
+            pending.push_back(async(launch::async, fn, ref(shard)));
+        }
+        for (auto& f : pending) {
+            f.get();
+        }
+    }
+
+public:
+    // Site i becomes shard i and owns the i-th ID range
+    HospitalNetwork(const vector<string>& siteDirs) {
+        for (size_t i = 0; i < siteDirs.size(); i++) {
+            shards.push_back(HospitalSystem(siteDirs[i], (int)i));
+        }
+    }
+    
+    size_t shardCount() const { return shards.size(); }
+    HospitalSystem& shard(size_t index) { return shards[index]; }
+    const HospitalSystem& shard(size_t index) const { return shards[index]; }
+    
+    // Owning shard for an ID, or nullptr if no site owns that range
+    HospitalSystem* owningShard(int id) {
+        int index = HospitalSystem::shardForId(id);
+        if (index < 0 || index >= (int)shards.size()) return nullptr;
+        return &shards[index];
+    }
+    
+    const HospitalSystem* owningShard(int id) const {
+        int index = HospitalSystem::shardForId(id);
+        if (index < 0 || index >= (int)shards.size()) return nullptr;
+        return &shards[index];
+    }
+    
+    // Routed lookups
+    const Patient* findPatient(int id) const {
+        const HospitalSystem* owner = owningShard(id);
+        return owner ? owner->findPatient(id) : nullptr;
+    }
+    
+    const Doctor* findDoctor(int id) const {
+        const HospitalSystem* owner = owningShard(id);
+        return owner ? owner->findDoctor(id) : nullptr;
+    }
+    
+    const Nurse* findNurse(int id) const {
+        const HospitalSystem* owner = owningShard(id);
+        return owner ? owner->findNurse(id) : nullptr;
+    }
+    
+    const Appointment* findAppointment(int id) const {
+        const HospitalSystem* owner = owningShard(id);
+        return owner ? owner->findAppointment(id) : nullptr;
+    }
+    
+    // The appointment is stored on the doctor's shard; a patient from another
+    // site is linked to the doctor on its own shard. Returns 0 if either is unknown.
+    int bookAppointment(int patientId, int doctorId, string date, string time) {
+        HospitalSystem* patientShard = owningShard(patientId);
+        HospitalSystem* doctorShard = owningShard(doctorId);
+        if (!patientShard || !doctorShard) return 0;
+        if (!patientShard->findPatient(patientId) || !doctorShard->findDoctor(doctorId)) return 0;
+        
+        int appId = doctorShard->scheduleAppointment(patientId, doctorId, date, time);
+        if (appId != 0 && patientShard != doctorShard) {
+            patientShard->assignDoctorToPatient(patientId, doctorId);
+        }
+        return appId;
+    }
+    
+    bool cancelAppointment(int appId) {
+        HospitalSystem* owner = owningShard(appId);
+        return owner ? owner->cancelAppointment(appId) : false;
+    }
+    
+    // Cross-shard queries
+    vector<Patient> findPatients(function<bool(const Patient&)> pred) const {
+        return fanOut<Patient>([&pred](const HospitalSystem& h) {
+            vector<Patient> result;
+            for (const auto& p : h.getPatients()) {
+                if (pred(p)) result.push_back(p);
             }
-            aFile.close();
+            return result;
+        });
+    }
+    
+    vector<Doctor> findDoctors(function<bool(const Doctor&)> pred) const {
+        return fanOut<Doctor>([&pred](const HospitalSystem& h) {
+            vector<Doctor> result;
+            for (const auto& d : h.getDoctors()) {
+                if (pred(d)) result.push_back(d);
+            }
+            return result;
+        });
+    }
+    
+    vector<Nurse> findNurses(function<bool(const Nurse&)> pred) const {
+        return fanOut<Nurse>([&pred](const HospitalSystem& h) {
+            vector<Nurse> result;
+            for (const auto& n : h.getNurses()) {
+                if (pred(n)) result.push_back(n);
+            }
+            return result;
+        });
+    }
+    
+    vector<Appointment> findAppointments(function<bool(const Appointment&)> pred) const {
+        return fanOut<Appointment>([&pred](const HospitalSystem& h) {
+            vector<Appointment> result;
+            for (const auto& app : h.getAppointments()) {
+                if (pred(app)) result.push_back(app);
+            }
+            return result;
+        });
+    }
+    
+    vector<Patient> queryPatients(const PatientQuery& q) const {
+        return fanOut<Patient>([&q](const HospitalSystem& h) { return h.queryPatients(q); });
+    }
+    
+    vector<Appointment> queryAppointments(const AppointmentQuery& q) const {
+        return fanOut<Appointment>([&q](const HospitalSystem& h) { return h.queryAppointments(q); });
+    }
+    
+    // File Handling (each site reads and writes its own directory in parallel)
+    void loadAll() {
+        forEachShard([](HospitalSystem& h) { h.loadFromFiles(false); });
+    }
+    
+    void saveAll() {
+        forEachShard([](HospitalSystem& h) { h.saveToFiles(false); });
+    }
+};
+
+// Streaming bulk import/export in the same line format as the data files.
+// Input is read one line at a time and applied in fixed-size batches, and
+// export writes straight from the stored records. Besides the batch, import
+// only remembers the IDs it has seen, for duplicate counting.
+//
+// Import stores rows as given: a doctor's patient list and a patient's
+// assigned doctor come from their own files, not from imported appointments.
+// Appointments must refer to a doctor on this site (and to a patient on it,
+// when the patient ID belongs to this shard), so import patients and doctors
+// first.
+class BulkTransfer {
+public:
+    struct ImportReport {
+        size_t lines = 0;
+        size_t inserted = 0;
+        size_t updated = 0;
+        size_t duplicates = 0;  // repeated IDs anywhere in the input; the last one wins
+        size_t rejected = 0;
+    };
+
+private:
+    HospitalSystem& hospital;
+    size_t batchSize;
+    ostream& errors;
+    
+    template <typename T>
+    ImportReport importRecords(istream& in) {
+        ImportReport report;
+        vector<T> batch;
+        unordered_map<int, size_t> batchRows;
+        unordered_set<int> seenIds;
+        size_t batchRepeats = 0;  // batch entries whose ID an earlier batch already stored
+        batch.reserve(batchSize);
+        
+        auto flush = [&]() {
+            HospitalSystem::UpsertResult result = hospital.upsert(batch);
+            report.inserted += result.inserted;
+            report.updated += result.updated - batchRepeats;
+            batch.clear();
+            batchRows.clear();
+            batchRepeats = 0;
+        };
+        
+        string line, error;
+        bool escaped = false;
+        while (getline(in, line)) {
+            report.lines++;
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (report.lines == 1 && line == DATA_FORMAT_HEADER) {
+                escaped = true;
+                continue;
+            }
+            if (line.empty() || line[0] == '#') continue;
+            
+            T record;
+            if (!T::tryParse(line, record, error, true, escaped)) {
+                errors << "line " << report.lines << ": " << error << endl;
+                report.rejected++;
+                continue;
+            }
+            
+            int id = recordId(record);
+            if (!hospital.ownsId(id)) {
+                errors << "line " << report.lines << ": ID " << id << " belongs to shard "
+                       << HospitalSystem::shardForId(id) << endl;
+                report.rejected++;
+                continue;
+            }
+            
+            if (!referencesExist(record, error)) {
+                errors << "line " << report.lines << ": " << error << endl;
+                report.rejected++;
+                continue;
+            }
+            
+            auto it = batchRows.find(id);
+            if (it != batchRows.end()) {
+                batch[it->second] = record;
+                report.duplicates++;
+                continue;
+            }
+            if (!seenIds.insert(id).second) {
+                report.duplicates++;
+                batchRepeats++;
+            }
+            batchRows[id] = batch.size();
+            batch.push_back(record);
+            
+            if (batch.size() >= batchSize) flush();
         }
+        if (!batch.empty()) flush();
         
-        // Load next IDs
-        ifstream idFile("nextids.txt");
-        if (idFile.is_open()) {
-            idFile >> nextPatientId >> nextDoctorId >> nextNurseId >> nextAppointmentId;
-            idFile.close();
+        return report;
+    }
+    
+    bool referencesExist(const Person&, string&) const {
+        return true;
+    }
+    
+    bool referencesExist(const Appointment& app, string& error) const {
+        if (!hospital.findDoctor(app.getDoctorId())) {
+            error = "doctor " + to_string(app.getDoctorId()) + " not found at this site";
+            return false;
+        }
+        if (hospital.ownsId(app.getPatientId()) && !hospital.findPatient(app.getPatientId())) {
+            error = "patient " + to_string(app.getPatientId()) + " not found at this site";
+            return false;
+        }
+        return true;
+    }
+    
+    template <typename T>
+    static size_t writeRows(ostream& out, const vector<T>& records, const SelectionBitmap& selection) {
+        size_t written = 0;
+        selection.forEachSelected([&](size_t row) {
+            out << records[row].toFileString() << '\n';
+            written++;
+        });
+        return written;
+    }
+
+public:
+    BulkTransfer(HospitalSystem& h, size_t batch = 1000, ostream& err = cerr)
+        : hospital(h), batchSize(batch > 0 ? batch : 1), errors(err) {}
+    
+    // kind is one of: patients, doctors, nurses, appointments.
+    // Returns false for an unknown kind.
+    bool importStream(const string& kind, istream& in, ImportReport& report) {
+        if (kind == "patients") report = importRecords<Patient>(in);
+        else if (kind == "doctors") report = importRecords<Doctor>(in);
+        else if (kind == "nurses") report = importRecords<Nurse>(in);
+        else if (kind == "appointments") report = importRecords<Appointment>(in);
+        else return false;
+        return true;
+    }
+    
+    // Writes the records matching the query (doctors and nurses are always
+    // exported in full). Returns false for an unknown kind.
+    bool exportStream(const string& kind, ostream& out, const PatientQuery& pq,
+                      const AppointmentQuery& aq, size_t& written) {
+        if (kind != "patients" && kind != "appointments" && kind != "doctors" && kind != "nurses") {
+            return false;
         }
         
-        cout << "\n✓ Data loaded successfully!\n";
+        out << DATA_FORMAT_HEADER << '\n';
+        if (kind == "patients") {
+            written = writeRows(out, hospital.getPatients(), hospital.selectPatients(pq));
+        } else if (kind == "appointments") {
+            written = writeRows(out, hospital.getAppointments(), hospital.selectAppointments(aq));
+        } else if (kind == "doctors") {
+            written = writeRows(out, hospital.getDoctors(), SelectionBitmap(hospital.getDoctors().size(), true));
+        } else if (kind == "nurses") {
+            written = writeRows(out, hospital.getNurses(), SelectionBitmap(hospital.getNurses().size(), true));
+        }
+        out.flush();
+        return true;
     }
 };
 
-// Main function with menu
-int main() {
-    HospitalSystem hospital;
-    hospital.loadFromFiles();
+// Non-interactive import: applies FILE ("-" for stdin) and saves the site
+int runImport(HospitalSystem& hospital, const string& kind, const string& fileName, size_t batchSize) {
+    ifstream file;
+    if (fileName != "-") {
+        file.open(fileName);
+        if (!file.is_open()) {
+            cerr << "Cannot open " << fileName << endl;
+            return 1;
+        }
+    }
+    istream& in = fileName == "-" ? cin : file;
+    
+    BulkTransfer transfer(hospital, batchSize);
+    BulkTransfer::ImportReport report;
+    if (!transfer.importStream(kind, in, report)) {
+        cerr << "Unknown record type: " << kind << endl;
+        return 1;
+    }
+    hospital.saveToFiles(false);
+    
+    cout << "Imported " << kind << ": " << report.lines << " lines, "
+         << report.inserted << " inserted, " << report.updated << " updated, "
+         << report.duplicates << " duplicates, " << report.rejected << " rejected" << endl;
+    return 0;
+}
+
+// Non-interactive export: writes matching records to FILE ("-" for stdout)
+int runExport(HospitalSystem& hospital, const string& kind, const string& fileName,
+              const PatientQuery& pq, const AppointmentQuery& aq) {
+    ofstream file;
+    if (fileName != "-") {
+        file.open(fileName);
+        if (!file.is_open()) {
+            cerr << "Cannot open " << fileName << endl;
+            return 1;
+        }
+    }
+    ostream& out = fileName == "-" ? cout : file;
+    
+    BulkTransfer transfer(hospital);
+    size_t written = 0;
+    if (!transfer.exportStream(kind, out, pq, aq, written)) {
+        cerr << "Unknown record type: " << kind << endl;
+        return 1;
+    }
     
+    cerr << "Exported " << written << " " << kind << endl;
+    return 0;
+}
+
+// Menu for a single site
+int runHospitalMenu(HospitalSystem& hospital) {
     int choice;
     
     while (true) {
@@ -685,7 +1906,9 @@ int main() {
         cout << "10. View All Appointments\n";
         cout << "11. Cancel Appointment\n";
         cout << "12. Save Data\n";
-        cout << "13. Exit\n";
+        cout << "13. Filter Patients\n";
+        cout << "14. Filter Appointments\n";
+        cout << "15. Exit\n";
         cout << "\nEnter your choice: ";
         cin >> choice;
         
@@ -727,6 +1950,12 @@ int main() {
                 hospital.saveToFiles();
                 break;
             case 13:
+                hospital.filterPatients();
+                break;
+            case 14:
+                hospital.filterAppointments();
+                break;
+            case 15:
                 hospital.saveToFiles();
                 cout << "\nThank you for using Hospital Management System!\n";
                 return 0;
@@ -737,3 +1966,658 @@ int main() {
     
     return 0;
 }
+
+// Reads a site number (1-based, as listed) and returns its shard, or nullptr
+HospitalSystem* chooseSite(HospitalNetwork& network) {
+    int site;
+    cout << "\nSites:\n";
+    for (size_t i = 0; i < network.shardCount(); i++) {
+        cout << (i + 1) << ". " << network.shard(i).getDataDir() << endl;
+    }
+    cout << "Enter Site Number: ";
+    cin >> site;
+    
+    if (site < 1 || site > (int)network.shardCount()) {
+        cout << "\nInvalid site!\n";
+        return nullptr;
+    }
+    return &network.shard(site - 1);
+}
+
+// Menu for a multi-site deployment
+int runNetworkMenu(HospitalNetwork& network) {
+    int choice;
+    
+    while (true) {
+        cout << "\n╔════════════════════════════════════════╗\n";
+        cout << "║   HOSPITAL NETWORK (" << setw(3) << network.shardCount() << " sites)        ║\n";
+        cout << "╚════════════════════════════════════════╝\n";
+        cout << "\n1.  Add Patient to Site\n";
+        cout << "2.  Add Doctor to Site\n";
+        cout << "3.  Add Nurse to Site\n";
+        cout << "4.  View All Patients\n";
+        cout << "5.  View All Doctors\n";
+        cout << "6.  View All Nurses\n";
+        cout << "7.  Search Patient\n";
+        cout << "8.  Search Doctor\n";
+        cout << "9.  Book Appointment\n";
+        cout << "10. View All Appointments\n";
+        cout << "11. Cancel Appointment\n";
+        cout << "12. Filter Patients\n";
+        cout << "13. Filter Appointments\n";
+        cout << "14. Save Data\n";
+        cout << "15. Exit\n";
+        cout << "\nEnter your choice: ";
+        cin >> choice;
+        
+        switch (choice) {
+            case 1: {
+                HospitalSystem* site = chooseSite(network);
+                if (site) site->addPatient();
+                break;
+            }
+            case 2: {
+                HospitalSystem* site = chooseSite(network);
+                if (site) site->addDoctor();
+                break;
+            }
+            case 3: {
+                HospitalSystem* site = chooseSite(network);
+                if (site) site->addNurse();
+                break;
+            }
+            case 4: {
+                vector<Patient> all = network.findPatients([](const Patient&) { return true; });
+                cout << "\n=== All Patients (" << all.size() << ") ===\n";
+                for (const auto& p : all) {
+                    cout << p.getInfo() << endl;
+                }
+                break;
+            }
+            case 5: {
+                vector<Doctor> all = network.findDoctors([](const Doctor&) { return true; });
+                cout << "\n=== All Doctors (" << all.size() << ") ===\n";
+                for (const auto& d : all) {
+                    cout << d.getInfo() << endl;
+                }
+                break;
+            }
+            case 6: {
+                vector<Nurse> all = network.findNurses([](const Nurse&) { return true; });
+                cout << "\n=== All Nurses (" << all.size() << ") ===\n";
+                for (const auto& n : all) {
+                    cout << n.getInfo() << endl;
+                }
+                break;
+            }
+            case 7: {
+                int id;
+                cout << "\nEnter Patient ID to search: ";
+                cin >> id;
+                const Patient* p = network.findPatient(id);
+                if (p) p->displayDetails();
+                else cout << "\nPatient not found!\n";
+                break;
+            }
+            case 8: {
+                int id;
+                cout << "\nEnter Doctor ID to search: ";
+                cin >> id;
+                const Doctor* d = network.findDoctor(id);
+                if (d) d->displayDetails();
+                else cout << "\nDoctor not found!\n";
+                break;
+            }
+            case 9: {
+                int patientId, doctorId;
+                string date, time;
+                cout << "\n=== Book Appointment ===\n";
+                cout << "Enter Patient ID: ";
+                cin >> patientId;
+                cout << "Enter Doctor ID: ";
+                cin >> doctorId;
+                if (!network.findPatient(patientId) || !network.findDoctor(doctorId)) {
+                    cout << "\nInvalid Patient ID or Doctor ID!\n";
+                    break;
+                }
+                cout << "Enter Date (DD/MM/YYYY): ";
+                cin >> date;
+                cout << "Enter Time (HH:MM): ";
+                cin >> time;
+                if (appointmentTimestamp(date, time) < 0) {
+                    cout << "\nInvalid date or time!\n";
+                    break;
+                }
+                int appId = network.bookAppointment(patientId, doctorId, date, time);
+                if (appId == 0) {
+                    cout << "\nCould not assign a new appointment ID at the doctor's site!\n";
+                    break;
+                }
+                cout << "\n✓ Appointment booked successfully! Appointment ID: " << appId << endl;
+                break;
+            }
+            case 10: {
+                vector<Appointment> all = network.findAppointments([](const Appointment&) { return true; });
+                if (all.empty()) {
+                    cout << "\nNo appointments scheduled.\n";
+                    break;
+                }
+                cout << "\n=== All Appointments ===\n";
+                for (const auto& app : all) {
+                    app.displayDetails();
+                }
+                break;
+            }
+            case 11: {
+                int appId;
+                cout << "\nEnter Appointment ID to cancel: ";
+                cin >> appId;
+                if (network.cancelAppointment(appId)) cout << "\n✓ Appointment cancelled successfully!\n";
+                else cout << "\nAppointment not found!\n";
+                break;
+            }
+            case 12: {
+                PatientQuery q;
+                if (readPatientQuery(q)) printMatchingPatients(network.queryPatients(q));
+                break;
+            }
+            case 13: {
+                AppointmentQuery q;
+                if (readAppointmentQuery(q)) printMatchingAppointments(network.queryAppointments(q));
+                break;
+            }
+            case 14:
+                network.saveAll();
+                cout << "\n✓ All sites saved successfully!\n";
+                break;
+            case 15:
+                network.saveAll();
+                cout << "\nThank you for using Hospital Management System!\n";
+                return 0;
+            default:
+                cout << "\nInvalid choice! Please try again.\n";
+        }
+    }
+    
+    return 0;
+}
+
+// Stress and fuzz harness for the storage code. Each cycle mutates every
+// site concurrently (one thread per site), saves, reloads into a fresh
+// network and checks that the reloaded state is identical. It also feeds
+// corrupted lines to the parsers. Runs are reproducible from the seed.
+class StressHarness {
+private:
+    static const int SITES = 3;
+    static const int OPS_PER_SITE = 400;
+    
+    unsigned seed;
+    string workDir;
+    
+    // Free text with separators, escapes, line breaks, empty and huge values
+    static string randomText(mt19937& rng) {
+        static const string alphabet = "abcXYZ 019,,::\\\\\n\r\t-'\"\xc3\xa9";
+        size_t length;
+        switch (rng() % 50) {
+            case 0: length = 0; break;
+            case 1: length = 20000 + rng() % 80000; break;
+            default: length = rng() % 24;
+        }
+        
+        string text;
+        text.reserve(length);
+        for (size_t i = 0; i < length; i++) {
+            text += alphabet[rng() % alphabet.size()];
+        }
+        return text;
+    }
+    
+    static string randomDate(mt19937& rng) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%02d/%02d/%04d", (int)(1 + rng() % 28), (int)(1 + rng() % 12), (int)(2000 + rng() % 30));
+        return buf;
+    }
+    
+    static string randomTime(mt19937& rng) {
+        char buf[8];
+        snprintf(buf, sizeof(buf), "%02d:%02d", (int)(rng() % 24), (int)(rng() % 60));
+        return buf;
+    }
+    
+    template <typename T>
+    static int randomId(const vector<T>& records, mt19937& rng) {
+        return records.empty() ? 0 : recordId(records[rng() % records.size()]);
+    }
+    
+    // One random mutation sequence against a single site
+    static void mutateSite(HospitalSystem& h, unsigned siteSeed) {
+        mt19937 rng(siteSeed);
+        for (int op = 0; op < OPS_PER_SITE; op++) {
+            int patientId = randomId(h.getPatients(), rng);
+            int doctorId = randomId(h.getDoctors(), rng);
+            
+            switch (rng() % 10) {
+                case 0: case 1: case 2: case 3:
+                    h.registerPatient(randomText(rng), rng() % 120, randomText(rng), randomText(rng), randomText(rng));
+                    break;
+                case 4:
+                    h.registerDoctor(randomText(rng), 25 + rng() % 50, randomText(rng), randomText(rng), randomText(rng));
+                    break;
+                case 5:
+                    h.registerNurse(randomText(rng), 20 + rng() % 50, randomText(rng), randomText(rng),
+                                    randomText(rng), randomText(rng));
+                    break;
+                case 6: case 7:
+                    h.bookAppointment(patientId, doctorId, randomDate(rng), randomTime(rng));
+                    break;
+                case 8:
+                    h.cancelAppointment(randomId(h.getAppointments(), rng));
+                    break;
+                case 9:
+                    h.assignDoctorToPatient(patientId, doctorId);
+                    break;
+            }
+        }
+    }
+    
+    // Randomly deletes, duplicates or replaces characters
+    static string corrupt(string line, mt19937& rng) {
+        static const string noise = ",:\\-0x9 \n";
+        int edits = 1 + rng() % 4;
+        for (int e = 0; e < edits && !line.empty(); e++) {
+            size_t pos = rng() % line.size();
+            switch (rng() % 3) {
+                case 0: line.erase(pos, 1 + rng() % 8); break;
+                case 1: line.insert(pos, line.substr(pos, rng() % 16)); break;
+                case 2: line[pos] = noise[rng() % noise.size()]; break;
+            }
+        }
+        return line;
+    }
+    
+    // Whatever a parser accepts must survive another serialize/parse round
+    // trip with every field unchanged
+    template <typename T>
+    static bool checkAcceptedLine(const string& line, bool strict, bool escaped, string& failure) {
+        T first, second;
+        string error;
+        if (!T::tryParse(line, first, error, strict, escaped)) return true;
+        
+        if (!T::tryParse(first.toFileString(), second, error, strict)) {
+            failure = "accepted line does not re-parse (" + error + "): " + line.substr(0, 200);
+            return false;
+        }
+        if (!sameFields(first, second)) {
+            failure = "accepted line changes on re-parse: " + line.substr(0, 200);
+            return false;
+        }
+        return true;
+    }
+    
+    static bool checkAllParsers(const string& line, string& failure) {
+        for (int mode = 0; mode < 4; mode++) {
+            bool strict = mode & 1, escaped = mode & 2;
+            if (!checkAcceptedLine<Patient>(line, strict, escaped, failure) ||
+                !checkAcceptedLine<Doctor>(line, strict, escaped, failure) ||
+                !checkAcceptedLine<Nurse>(line, strict, escaped, failure) ||
+                !checkAcceptedLine<Appointment>(line, strict, escaped, failure)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    // Stored records must parse back exactly (strictly, since the harness only
+    // creates valid data); corrupted copies of their lines go through
+    // checkAllParsers. Adds the number of lines tried to tried.
+    template <typename T>
+    static bool fuzzRecords(const vector<T>& records, mt19937& rng, long& tried, string& failure) {
+        for (int i = 0; i < 25 && !records.empty(); i++) {
+            const T& record = records[rng() % records.size()];
+            string line = record.toFileString();
+            
+            T parsed;
+            string error;
+            if (!T::tryParse(line, parsed, error)) {
+                failure = "stored record " + to_string(recordId(record)) + " does not parse: " + error;
+                return false;
+            }
+            if (!sameFields(record, parsed)) {
+                failure = "stored record " + to_string(recordId(record)) + " changes on re-parse";
+                return false;
+            }
+            
+            for (int k = 0; k < 4; k++) {
+                if (!checkAllParsers(corrupt(line, rng), failure)) return false;
+                tried++;
+            }
+        }
+        return true;
+    }
+    
+    // Returns the number of corrupted lines tried, or -1 after printing a failure
+    static long fuzzParsers(const HospitalSystem& h, mt19937& rng) {
+        long tried = 0;
+        string failure;
+        if (!fuzzRecords(h.getPatients(), rng, tried, failure) ||
+            !fuzzRecords(h.getDoctors(), rng, tried, failure) ||
+            !fuzzRecords(h.getNurses(), rng, tried, failure) ||
+            !fuzzRecords(h.getAppointments(), rng, tried, failure)) {
+            cout << "Parser check failed: " << failure << endl;
+            return -1;
+        }
+        return tried;
+    }
+    
+    // Patient line as the pre-escaping version wrote it: free text joined as-is,
+    // so commas and backslashes in it make some lines unreadable
+    static string randomLegacyLine(mt19937& rng) {
+        static const string alphabet = "abc 019,\\\\:-";
+        string fields[4];
+        for (string& field : fields) {
+            size_t length = rng() % 6;
+            for (size_t i = 0; i < length; i++) {
+                field += alphabet[rng() % alphabet.size()];
+            }
+        }
+        return to_string(1 + rng() % 40) + "," + fields[0] + "," + to_string(rng() % 120) + "," +
+               fields[1] + "," + fields[2] + "," + fields[3] + ",0";
+    }
+    
+    // A legacy file's kept lines are written back below the header on save;
+    // loading the saved file must give exactly the records the legacy file gave
+    static bool checkLegacyKeptLines(const string& dir, mt19937& rng, string& failure) {
+        filesystem::remove_all(dir);
+        filesystem::create_directories(dir);
+        ofstream file((filesystem::path(dir) / "patients.txt").string());
+        for (int i = 0; i < 60; i++) {
+            file << randomLegacyLine(rng) << '\n';
+        }
+        file.close();
+        
+        // The unreadable lines are expected here, so hide their warnings
+        streambuf* warnings = cerr.rdbuf(nullptr);
+        HospitalSystem legacy(dir);
+        legacy.loadFromFiles(false);
+        legacy.saveToFiles(false);
+        HospitalSystem resaved(dir);
+        resaved.loadFromFiles(false);
+        cerr.rdbuf(warnings);
+        
+        if (!legacy.sameState(resaved, failure)) {
+            failure = "legacy file changes after a save: " + failure;
+            return false;
+        }
+        filesystem::remove_all(dir);
+        return true;
+    }
+    
+    static size_t recordCount(const HospitalNetwork& network) {
+        size_t total = 0;
+        for (size_t i = 0; i < network.shardCount(); i++) {
+            const HospitalSystem& h = network.shard(i);
+            total += h.getPatients().size() + h.getDoctors().size() + h.getNurses().size() + h.getAppointments().size();
+        }
+        return total;
+    }
+    
+    uintmax_t dataBytes() const {
+        uintmax_t total = 0;
+        for (const auto& entry : filesystem::recursive_directory_iterator(workDir)) {
+            if (entry.is_regular_file()) total += entry.file_size();
+        }
+        return total;
+    }
+    
+    // Peak resident set size of this process in KB, or -1 where unsupported
+    static long peakMemoryKb() {
+#if defined(__unix__) || defined(__APPLE__)
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+#else
+        return -1;
+#endif
+    }
+
+public:
+    StressHarness(unsigned s)
+        : seed(s), workDir((filesystem::temp_directory_path() / ("hospital-stress-" + to_string(s))).string()) {}
+    
+    // Returns 0 if every cycle round-tripped, 1 otherwise
+    int run(int cycles) {
+        filesystem::remove_all(workDir);
+        vector<string> siteDirs;
+        for (int i = 0; i < SITES; i++) {
+            siteDirs.push_back((filesystem::path(workDir) / ("site-" + to_string(i))).string());
+        }
+        
+        HospitalNetwork network(siteDirs);
+        mt19937 rng(seed);
+        
+        cout << "Stress test: " << cycles << " cycles, " << SITES << " sites, seed " << seed << endl;
+        cout << left << setw(7) << "Cycle" << setw(10) << "Records" << setw(10) << "Data(KB)"
+             << setw(10) << "Save(ms)" << setw(10) << "Load(ms)" << setw(9) << "Fuzzed" << "Peak(MB)" << endl;
+        
+        for (int cycle = 1; cycle <= cycles; cycle++) {
+            // Concurrent mutation, one thread per site
+            vector<thread> workers;
+            for (int i = 0; i < SITES; i++) {
+                workers.emplace_back(mutateSite, ref(network.shard(i)), seed * 7919u + cycle * SITES + i);
+            }
+            for (auto& w : workers) {
+                w.join();
+            }
+            
+            // Cross-site bookings through the router
+            for (int i = 0; i < 20; i++) {
+                network.bookAppointment(randomId(network.shard(rng() % SITES).getPatients(), rng),
+                                        randomId(network.shard(rng() % SITES).getDoctors(), rng),
+                                        randomDate(rng), randomTime(rng));
+            }
+            
+            long fuzzed = fuzzParsers(network.shard(rng() % SITES), rng);
+            if (fuzzed < 0) {
+                cout << "FAILED in cycle " << cycle << "; data kept in " << workDir << endl;
+                return 1;
+            }
+            
+            string legacyFailure;
+            if (!checkLegacyKeptLines((filesystem::path(workDir) / "legacy").string(), rng, legacyFailure)) {
+                cout << "FAILED in cycle " << cycle << ": " << legacyFailure << "; data kept in " << workDir << endl;
+                return 1;
+            }
+            
+            auto t0 = chrono::steady_clock::now();
+            network.saveAll();
+            auto t1 = chrono::steady_clock::now();
+            HospitalNetwork reloaded(siteDirs);
+            reloaded.loadAll();
+            auto t2 = chrono::steady_clock::now();
+            
+            for (int i = 0; i < SITES; i++) {
+                string difference;
+                if (!network.shard(i).sameState(reloaded.shard(i), difference)) {
+                    cout << "FAILED in cycle " << cycle << ", site " << i << ": " << difference
+                         << "; data kept in " << workDir << endl;
+                    return 1;
+                }
+            }
+            
+            long peakKb = peakMemoryKb();
+            cout << left << setw(7) << cycle << setw(10) << recordCount(network) << setw(10) << dataBytes() / 1024
+                 << setw(10) << fixed << setprecision(1) << chrono::duration<double, milli>(t1 - t0).count()
+                 << setw(10) << chrono::duration<double, milli>(t2 - t1).count() << setw(9) << fuzzed;
+            if (peakKb >= 0) cout << peakKb / 1024.0;
+            else cout << "n/a";
+            cout << endl;
+            
+            // Keep going from the reloaded copy so later cycles mutate loaded state
+            network = reloaded;
+        }
+        
+        filesystem::remove_all(workDir);
+        cout << "All " << cycles << " cycles passed." << endl;
+        return 0;
+    }
+};
+
+// Main function
+// Usage:
+//   hospital                          single site in the current directory
+//   hospital --data-dir DIR --shard N single site N stored in DIR
+//   hospital --sites DIR1 DIR2 ...    all listed sites, site i is shard i-1
+//   hospital --import KIND FILE       upsert records into the site, then save
+//   hospital --export KIND FILE       write the site's records
+//   hospital --stress CYCLES          run the save/load stress test (--seed N)
+// KIND is patients, doctors, nurses or appointments; FILE may be "-".
+// Import takes --batch-size N. Export takes --min-age N, --max-age N,
+// --doctor ID, --status S, --from DD/MM/YYYY and --to DD/MM/YYYY.
+int main(int argc, char* argv[]) {
+    string dataDir = ".";
+    int shard = 0;
+    vector<string> sites;
+    string importKind, exportKind, transferFile;
+    int batchSize = 1000;
+    PatientQuery patientQuery;
+    AppointmentQuery appointmentQuery;
+    int stressCycles = 0;
+    int stressSeed = 1;
+    string singleSiteFlag;  // last flag that only applies to one site
+    string storedDataFlag;  // last flag that works on a stored site
+    
+    auto numberArg = [&](int& i, int& out) {
+        if (i + 1 >= argc || !parseInt(argv[i + 1], out)) {
+            cerr << "Expected a number after " << argv[i] << endl;
+            return false;
+        }
+        i++;
+        return true;
+    };
+    
+    auto dateArg = [&](int& i, const string& time, int64_t& out) {
+        if (i + 1 >= argc || (out = appointmentTimestamp(argv[i + 1], time)) < 0) {
+            cerr << "Expected a date (DD/MM/YYYY) after " << argv[i] << endl;
+            return false;
+        }
+        i++;
+        return true;
+    };
+    
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--data-dir" || arg == "--shard" || arg == "--import" || arg == "--export" ||
+            arg == "--stress") {
+            singleSiteFlag = arg;
+        }
+        if (arg == "--data-dir" || arg == "--shard" || arg == "--import" || arg == "--export") {
+            storedDataFlag = arg;
+        }
+        
+        if (arg == "--data-dir") {
+            if (i + 1 >= argc) {
+                cerr << "Expected a directory after --data-dir" << endl;
+                return 1;
+            }
+            dataDir = argv[++i];
+        } else if (arg == "--shard") {
+            if (!numberArg(i, shard)) return 1;
+            if (shard < 0 || shard > HospitalSystem::MAX_SHARD) {
+                cerr << "Shard index must be between 0 and " << HospitalSystem::MAX_SHARD << endl;
+                return 1;
+            }
+        } else if (arg == "--sites") {
+            while (i + 1 < argc && string(argv[i + 1]).rfind("--", 0) != 0) {
+                sites.push_back(argv[++i]);
+            }
+        } else if (arg == "--import" || arg == "--export") {
+            if (i + 2 >= argc) {
+                cerr << "Expected " << (i + 1 >= argc ? "KIND and FILE" : "FILE") << " after " << arg << endl;
+                return 1;
+            }
+            (arg == "--import" ? importKind : exportKind) = argv[++i];
+            transferFile = argv[++i];
+        } else if (arg == "--stress") {
+            if (!numberArg(i, stressCycles)) return 1;
+            if (stressCycles <= 0) {
+                cerr << "--stress needs a positive number of cycles" << endl;
+                return 1;
+            }
+        } else if (arg == "--seed") {
+            if (!numberArg(i, stressSeed)) return 1;
+        } else if (arg == "--batch-size") {
+            if (!numberArg(i, batchSize)) return 1;
+        } else if (arg == "--min-age") {
+            if (!numberArg(i, patientQuery.minAge)) return 1;
+        } else if (arg == "--max-age") {
+            if (!numberArg(i, patientQuery.maxAge)) return 1;
+        } else if (arg == "--doctor") {
+            int doctorId;
+            if (!numberArg(i, doctorId)) return 1;
+            patientQuery.assignedDoctorId = doctorId;
+            appointmentQuery.doctorId = doctorId;
+        } else if (arg == "--status" && i + 1 < argc) {
+            appointmentQuery.status = statusCode(argv[++i]);
+            if (*appointmentQuery.status == STATUS_UNKNOWN) {
+                cerr << "Status must be Scheduled, Completed or Cancelled" << endl;
+                return 1;
+            }
+        } else if (arg == "--from") {
+            if (!dateArg(i, "00:00", appointmentQuery.from)) return 1;
+        } else if (arg == "--to") {
+            if (!dateArg(i, "23:59", appointmentQuery.to)) return 1;
+        } else {
+            cerr << "Unknown argument: " << arg << endl;
+            return 1;
+        }
+    }
+    
+    if (!importKind.empty() && !exportKind.empty()) {
+        cerr << "--import and --export cannot be combined" << endl;
+        return 1;
+    }
+    
+    if (!sites.empty() && !singleSiteFlag.empty()) {
+        cerr << singleSiteFlag << " cannot be combined with --sites" << endl;
+        return 1;
+    }
+    
+    // The stress test builds and deletes its own sites in a temporary directory
+    if (stressCycles > 0) {
+        if (!storedDataFlag.empty()) {
+            cerr << storedDataFlag << " cannot be combined with --stress" << endl;
+            return 1;
+        }
+        StressHarness harness((unsigned)stressSeed);
+        return harness.run(stressCycles);
+    }
+    
+    if (sites.size() > (size_t)HospitalSystem::MAX_SHARD + 1) {
+        cerr << "At most " << HospitalSystem::MAX_SHARD + 1 << " sites are supported" << endl;
+        return 1;
+    }
+    
+    if (!sites.empty()) {
+        HospitalNetwork network(sites);
+        network.loadAll();
+        cout << "\n✓ Data loaded successfully from " << sites.size() << " sites!\n";
+        return runNetworkMenu(network);
+    }
+    
+    HospitalSystem hospital(dataDir, shard);
+    
+    if (!importKind.empty() || !exportKind.empty()) {
+        hospital.loadFromFiles(false);
+        if (!importKind.empty()) {
+            return runImport(hospital, importKind, transferFile, batchSize > 0 ? batchSize : 1);
+        }
+        return runExport(hospital, exportKind, transferFile, patientQuery, appointmentQuery);
+    }
+    
+    hospital.loadFromFiles();
+    return runHospitalMenu(hospital);
+}